@@ -35,13 +35,16 @@ const char *root_ca =
     "LPAvTK33sefOT6jEm0pUBsV/fdUID+Ic/n4XuKxe9tQWskMJDE32p2u0mYRlynqI\n"
     "4uJEvlz36hz1\n"
     "-----END CERTIFICATE-----\n";
+
+// Caches the resolved address of your tenant, which saves a DNS lookup on every reconnect.
+HttpUpstreamSecureConnectionFactory connectionFactory(networkClient, root_ca);
+HttpUpstreamClient c8yClient(connectionFactory);
 #else
 #include <WiFiNINA.h>
 
 WiFiSSLClient networkClient;
-#endif
-
 HttpUpstreamClient c8yClient(networkClient);
+#endif
 
 int status = WL_IDLE_STATUS;
 
@@ -97,6 +100,11 @@ void setup()
   // I.e. if you are running this for the first time, it registers the device with your tenant.
   // If you are running this a second and subsequent times, it loads device credentials from persistent memory etc.
   // Limitation: It expects that EEPROM - persistent memory - was not tampered with.
+  //
+  // If you already have device credentials and a device ID, e.g. for a mass rollout, you can skip registration entirely:
+  // c8yClient.importCredentials(host, "<tenant id>", "<device username>", "<device password>", "<device id>");
+  //
+  // registerDevice gives up after 10 minutes. Use beginRegistration and call poll from loop, if your sketch has to keep running meanwhile.
   status = c8yClient.registerDevice(host, deviceName);
   // POSIX convention is to return 0 when everything is ok and 1 to 255 for everything else.
   // Because in C false is defined as 0 and true as everything not 0, the POSIX convention is convenient for error handling like this.
@@ -120,10 +128,16 @@ void loop()
   // Send measurement.
   c8yClient.sendMeasurement("c8y_TemperatureMeasurement", "c8y_Steam", "T", temperature, "C");
 
-  // Send an alarm, when something occurs, which requires human intervention.
+  // Raise an alarm, when something occurs, which requires human intervention.
+  // While the alarm is active, raising it again is only counted locally and does not send anything.
+  // Clear the alarm, when the condition is gone.
   if (temperature > 490)
   {
-    c8yClient.sendAlarm("example-alarm-type", "Steam is very hot right now. Might be due to fast proton.", "WARNING");
+    c8yClient.raiseAlarm("example-alarm-type", "Steam is very hot right now. Might be due to fast proton.", "WARNING");
+  }
+  else
+  {
+    c8yClient.clearAlarm("example-alarm-type");
   }
 
   // Send an event, when something occurs, which should be logged and does not require human intervention.
@@ -11,6 +11,83 @@
 #include <WiFiUdp.h>
 #include <WiFi.h>
 #include <EEPROM.h>
+#include "HttpUpstreamConnectionFactory.h"
+#include "HttpUpstreamSeriesBuffer.h"
+
+#ifndef HTTP_UPSTREAM_RESPONSE_TIMEOUT
+#define HTTP_UPSTREAM_RESPONSE_TIMEOUT 10000 // ms
+#endif
+
+#ifndef HTTP_UPSTREAM_REGISTRATION_TIMEOUT
+#define HTTP_UPSTREAM_REGISTRATION_TIMEOUT 600000 // ms
+#endif
+
+#ifndef HTTP_UPSTREAM_MIN_BACKOFF
+#define HTTP_UPSTREAM_MIN_BACKOFF 3000 // ms
+#endif
+
+#ifndef HTTP_UPSTREAM_MAX_BACKOFF
+#define HTTP_UPSTREAM_MAX_BACKOFF 30000 // ms
+#endif
+
+#ifndef HTTP_UPSTREAM_STREAM_BUFFER_SIZE
+#define HTTP_UPSTREAM_STREAM_BUFFER_SIZE 64
+#endif
+
+#ifndef HTTP_UPSTREAM_BATCH_SIZE
+#define HTTP_UPSTREAM_BATCH_SIZE 20
+#endif
+
+#ifndef HTTP_UPSTREAM_PIPELINE_DEPTH
+#define HTTP_UPSTREAM_PIPELINE_DEPTH 4
+#endif
+
+// Not overridable: it sets the size of HttpUpstreamClient, and the library is compiled without the defines of the sketch.
+#define HTTP_UPSTREAM_MAX_CONNECTIONS 3
+
+#ifndef HTTP_UPSTREAM_ALARM_CHECK_INTERVAL
+#define HTTP_UPSTREAM_ALARM_CHECK_INTERVAL 600000 // ms
+#endif
+
+// Not overridable: it sets the size of HttpUpstreamClient, and the library is compiled without the defines of the sketch.
+#define HTTP_UPSTREAM_MAX_ALARMS 4
+
+enum HttpUpstreamRegistrationState
+{
+  HTTP_UPSTREAM_UNREGISTERED,
+  HTTP_UPSTREAM_REQUESTING_CREDENTIALS,
+  HTTP_UPSTREAM_AWAITING_CREDENTIALS,
+  HTTP_UPSTREAM_CREATING_DEVICE,
+  HTTP_UPSTREAM_AWAITING_DEVICE,
+  HTTP_UPSTREAM_BACKOFF,
+  HTTP_UPSTREAM_REGISTERED,
+  HTTP_UPSTREAM_REGISTRATION_FAILED
+};
+
+/**
+ * @brief Reads the next chunk of a binary into buffer.
+ *
+ * @return int number of bytes read; 0 = end of binary, negative = error
+ */
+typedef int (*HttpUpstreamChunkReader)(uint8_t *buffer, size_t size, void *context);
+
+struct HttpUpstreamConnectionStats
+{
+  unsigned long requests;
+  unsigned long failures;
+  unsigned long connectFailures;
+  unsigned long samples;
+  unsigned long responseTime; // ms from writing requests until their responses were read
+};
+
+struct HttpUpstreamAlarm
+{
+  char *type;
+  char *severity;
+  char id[16];
+  unsigned long count;
+  unsigned long checkedAt; // millis of the last update, which confirmed that the alarm is active on the tenant
+};
 
 class HttpUpstreamClient
 {
@@ -21,21 +98,64 @@ private:
   char *_deviceCredentials;
   char *_deviceID;
   Client *_networkClient;
+  HttpUpstreamConnectionFactory *_connection;
+  bool _ownsConnection;
+  HttpUpstreamConnectionFactory *_connections[HTTP_UPSTREAM_MAX_CONNECTIONS];
+  HttpUpstreamConnectionStats _connectionStats[HTTP_UPSTREAM_MAX_CONNECTIONS];
+  uint8_t _connectionCount;
+  uint8_t _parallelism;
+  bool _parallelismSet;
+  HttpUpstreamAlarm _alarms[HTTP_UPSTREAM_MAX_ALARMS];
+  uint8_t _pipelineDepth;
+
+  const char *_bootstrapCredentials;
+  char *_registrationHost;
+  char *_deviceName;
+  HttpUpstreamRegistrationState _registrationState;
+  HttpUpstreamRegistrationState _retryState;
+  unsigned long _registrationStart;
+  unsigned long _registrationTimeout;
+  unsigned long _stateSince;
+  unsigned long _backoff;
+  unsigned long _retryDelay;
+  bool _timeSynced;
 
+  void setDeviceCredentials(const char *tenantId, const char *username, const char *password);
   int storeDeviceCredentialsAndHost(char *host, const char *tenantId, const char *username, const char *password);
   int storeDeviceID();
   int loadDeviceCredentialsAndHostFromEEPROM();
-  int requestDeviceCredentialsFromTenant(char *host);
+  String getBootstrapID();
   int loadDeviceIDFromEEPROM();
-  int registerDeviceWithTenant(char *deviceName);
+  void sendRegistrationRequest();
+  void receiveRegistrationResponse();
+  void retryRegistration();
   int sendMeasurement(char *body);
 
+  void writeRequestHeader(Print &out, const char *method, const char *path, const char *contentType, long contentLength);
+  int readResponse(HttpUpstreamConnectionFactory &connection, const char *field, char *value, size_t valueSize);
+  int readResponse(HttpUpstreamConnectionFactory &connection, uint8_t fieldCount, const char *const *fields, char *const *values, size_t valueSize);
+  int updateAlarm(HttpUpstreamAlarm *alarm, const char *update);
+  HttpUpstreamAlarm *findAlarm(const char *type);
+  void forgetAlarm(HttpUpstreamAlarm *alarm);
+  void printMeasurements(Print &out, HttpUpstreamSeriesBuffer &buffer, HttpUpstreamSeriesCursor &cursor, uint16_t count);
+  uint8_t writeMeasurementBatches(Client &client, HttpUpstreamSeriesBuffer &buffer, HttpUpstreamSeriesCursor &cursor, uint16_t &remaining, uint16_t batchSize, uint8_t maxBatches, uint16_t *counts);
+  bool acknowledgeMeasurementBatches(HttpUpstreamSeriesBuffer &buffer, uint16_t *counts, int *statuses, uint8_t batches);
+
 public:
   HttpUpstreamClient(Client &networkClient);
+  HttpUpstreamClient(HttpUpstreamConnectionFactory &connectionFactory);
+  ~HttpUpstreamClient();
 
   int registerDevice(char *host, char *deviceName);
   int registerDevice(char *host, char *deviceName, char *supportedOperations[]);
 
+  void beginRegistration(char *host, char *deviceName);
+  HttpUpstreamRegistrationState poll();
+  HttpUpstreamRegistrationState registrationState();
+  void setBootstrapCredentials(const char *bootstrapCredentials);
+  void setRegistrationTimeout(unsigned long timeout);
+  void importCredentials(char *host, const char *tenantId, const char *username, const char *password, const char *deviceID);
+
   void removeDevice();
   void removeDevice(bool forceClearEEPROM);
 
@@ -44,9 +164,30 @@ public:
   int sendMeasurement(char *type, char *fragment, char *series, float value);
   int sendMeasurement(char *type, char *fragment, char *series, float value, char *unit);
 
+  bool syncTime();
+  bool isTimeSynced();
+  unsigned long getEpochTime();
+
+  void setPipelineDepth(uint8_t depth);
+  bool addConnection(HttpUpstreamConnectionFactory &connectionFactory);
+  void setParallelism(uint8_t parallelism);
+  HttpUpstreamConnectionStats connectionStats(uint8_t index);
+  bool bufferMeasurement(HttpUpstreamSeriesBuffer &buffer, float value);
+  int sendMeasurements(HttpUpstreamSeriesBuffer &buffer, uint16_t batchSize = HTTP_UPSTREAM_BATCH_SIZE);
+
   void sendAlarm(char *alarm_Type, char *alarm_Text, char *severity);
 
+  int raiseAlarm(char *type, char *text, char *severity);
+  int clearAlarm(char *type);
+  unsigned long alarmCount(char *type);
+  const char *alarmSeverity(char *type);
+  bool alarmNeedsUpdate(char *type, char *severity);
+
   void sendEvent(char *event_Type, char *event_Text);
+
+  int createEvent(char *type, char *text, char *eventID, size_t eventIDSize);
+  int sendEventBinary(char *eventID, char *contentType, Stream &source, long length = -1);
+  int sendEventBinary(char *eventID, char *contentType, HttpUpstreamChunkReader reader, void *context, long length = -1);
 };
 
 #endif
@@ -0,0 +1,189 @@
+#include "HttpUpstreamConnectionFactory.h"
+
+// Implementation notes
+//
+// Every request of HttpUpstreamClient opens its connection through a connection factory.
+// This is the place for everything, which makes (re)connecting cheaper:
+// * The resolved address of the host is cached for HTTP_UPSTREAM_DNS_CACHE_TTL ms.
+// * resumeSession and saveSession are called around every connection. They do nothing in the factories of this
+//   library, because none of the supported network clients exposes its TLS session. They are the override point
+//   for a subclass, whose network client does, to offer the session again and do an abbreviated handshake.
+//
+// The plain factory connects by host name by default, because most TLS clients (e.g. WiFiSSLClient)
+// need the host name for SNI and certificate verification and would fail when given an address only.
+// Enable the DNS cache with setDnsCacheTtl for clients, which do not need the host name,
+// or use a factory which passes both, like HttpUpstreamSecureConnectionFactory on ESP32.
+
+/**
+ * @brief Creates a connection factory for the given network client.
+ *
+ * DNS caching is disabled. See setDnsCacheTtl.
+ *
+ * @param client network client used for all connections
+ */
+HttpUpstreamConnectionFactory::HttpUpstreamConnectionFactory(Client &client)
+{
+  _client = &client;
+  _cachedHost = NULL;
+  _cachedAt = 0;
+  _dnsCacheTtl = 0;
+}
+
+HttpUpstreamConnectionFactory::~HttpUpstreamConnectionFactory()
+{
+  if (_cachedHost)
+    free(_cachedHost);
+}
+
+/**
+ * @brief Network client used for all connections
+ */
+Client &HttpUpstreamConnectionFactory::client()
+{
+  return *_client;
+}
+
+/**
+ * @brief Sets for how long a resolved host address is reused.
+ *
+ * @param ttl time to live in ms; 0 disables the DNS cache and connects by host name
+ */
+void HttpUpstreamConnectionFactory::setDnsCacheTtl(unsigned long ttl)
+{
+  _dnsCacheTtl = ttl;
+  invalidateDnsCache();
+}
+
+/**
+ * @brief Forgets the cached host address, so that the next connect resolves the host again.
+ */
+void HttpUpstreamConnectionFactory::invalidateDnsCache()
+{
+  if (_cachedHost)
+    free(_cachedHost);
+  _cachedHost = NULL;
+}
+
+/**
+ * @brief Resolves host, using the cached address while it is fresh.
+ *
+ * @return int 1 = ok, 0 = host could not be resolved
+ */
+int HttpUpstreamConnectionFactory::resolve(const char *host, IPAddress &address)
+{
+  if (_cachedHost && !strcmp(_cachedHost, host) && millis() - _cachedAt < _dnsCacheTtl)
+  {
+    address = _cachedAddress;
+    return 1;
+  }
+
+  invalidateDnsCache();
+  if (WiFi.hostByName(host, address) != 1)
+  {
+    return 0;
+  }
+  _cachedHost = strdup(host);
+  _cachedAddress = address;
+  _cachedAt = millis();
+  return 1;
+}
+
+/**
+ * @brief Opens a connection to host.
+ *
+ * Offers a previously saved TLS session and uses the cached host address, if enabled.
+ *
+ * @param host
+ * @param port
+ * @return int 1 = connected, 0 = could not connect
+ */
+int HttpUpstreamConnectionFactory::connect(const char *host, uint16_t port)
+{
+  resumeSession();
+
+  if (_dnsCacheTtl == 0)
+  {
+    return _client->connect(host, port);
+  }
+
+  IPAddress address;
+  if (!resolve(host, address))
+  {
+    // Let the client try on its own, e.g. in case it uses a different resolver.
+    return _client->connect(host, port);
+  }
+  if (connectToAddress(address, host, port))
+  {
+    return 1;
+  }
+  // The cached address might be stale
+  invalidateDnsCache();
+  return 0;
+}
+
+/**
+ * @brief Closes the connection and keeps its TLS session for the next connect.
+ */
+void HttpUpstreamConnectionFactory::stop()
+{
+  saveSession();
+  _client->stop();
+}
+
+/**
+ * @brief Opens a connection to an already resolved address.
+ *
+ * @param address resolved address of host
+ * @param host host name, e.g. for SNI
+ * @param port
+ * @return int 1 = connected, 0 = could not connect
+ */
+int HttpUpstreamConnectionFactory::connectToAddress(IPAddress address, const char *host, uint16_t port)
+{
+  return _client->connect(address, port);
+}
+
+/**
+ * @brief Hands a saved TLS session back to the network client before connecting.
+ *
+ * Does nothing by default. Override for network clients, which expose their TLS session.
+ */
+void HttpUpstreamConnectionFactory::resumeSession()
+{
+}
+
+/**
+ * @brief Takes the TLS session from the network client before it is stopped.
+ *
+ * Called on every stop, also when the connection is already closed, e.g. by the tenant.
+ * Keep the previously saved session, if the network client has none.
+ *
+ * Does nothing by default. Override for network clients, which expose their TLS session.
+ */
+void HttpUpstreamConnectionFactory::saveSession()
+{
+}
+
+#if defined(ARDUINO_ARCH_ESP32)
+/**
+ * @brief Creates a connection factory for WiFiClientSecure with DNS caching enabled.
+ *
+ * The ESP32 core does not expose the mbedTLS session of WiFiClientSecure, so sessions are not resumed.
+ * It does however accept an address and the host name for verification, which makes the DNS cache usable.
+ *
+ * @param client network client used for all connections
+ * @param rootCA root CA certificate of the host
+ */
+HttpUpstreamSecureConnectionFactory::HttpUpstreamSecureConnectionFactory(WiFiClientSecure &client, const char *rootCA)
+    : HttpUpstreamConnectionFactory(client)
+{
+  _secureClient = &client;
+  _rootCA = rootCA;
+  setDnsCacheTtl(HTTP_UPSTREAM_DNS_CACHE_TTL);
+}
+
+int HttpUpstreamSecureConnectionFactory::connectToAddress(IPAddress address, const char *host, uint16_t port)
+{
+  return _secureClient->connect(address, port, host, _rootCA, NULL, NULL);
+}
+#endif
@@ -0,0 +1,62 @@
+
+#ifndef HttpUpstreamConnectionFactory_h
+#define HttpUpstreamConnectionFactory_h
+
+#include "Arduino.h"
+#include <Client.h>
+#include <WiFi.h>
+#if defined(ARDUINO_ARCH_ESP32)
+#include <WiFiClientSecure.h>
+#endif
+
+#ifndef HTTP_UPSTREAM_DNS_CACHE_TTL
+#define HTTP_UPSTREAM_DNS_CACHE_TTL 300000 // ms
+#endif
+
+class HttpUpstreamConnectionFactory
+{
+
+private:
+  Client *_client;
+  char *_cachedHost;
+  IPAddress _cachedAddress;
+  unsigned long _cachedAt;
+  unsigned long _dnsCacheTtl;
+
+  int resolve(const char *host, IPAddress &address);
+
+protected:
+  virtual int connectToAddress(IPAddress address, const char *host, uint16_t port);
+  virtual void resumeSession();
+  virtual void saveSession();
+
+public:
+  HttpUpstreamConnectionFactory(Client &client);
+  virtual ~HttpUpstreamConnectionFactory();
+
+  Client &client();
+
+  void setDnsCacheTtl(unsigned long ttl);
+  void invalidateDnsCache();
+
+  virtual int connect(const char *host, uint16_t port);
+  virtual void stop();
+};
+
+#if defined(ARDUINO_ARCH_ESP32)
+class HttpUpstreamSecureConnectionFactory : public HttpUpstreamConnectionFactory
+{
+
+private:
+  WiFiClientSecure *_secureClient;
+  const char *_rootCA;
+
+protected:
+  int connectToAddress(IPAddress address, const char *host, uint16_t port);
+
+public:
+  HttpUpstreamSecureConnectionFactory(WiFiClientSecure &client, const char *rootCA);
+};
+#endif
+
+#endif
@@ -0,0 +1,337 @@
+#include "HttpUpstreamScheduler.h"
+
+// Implementation notes
+//
+// Keeping WiFi connected all the time costs far more energy than sending the data.
+// The scheduler keeps the radio off and only brings it up for flush windows:
+// * every flush interval,
+// * when a series buffer is filled beyond the fill threshold, so that no samples are dropped,
+// * right away for alarm state changes. Buffered samples are sent in the same window.
+// Repeated raises of an active alarm are only counted locally by HttpUpstreamClient and do not need the radio,
+// except for the occasional check, that the alarm was not cleared on the tenant.
+//
+// After a failed window, e.g. no WiFi or a batch the tenant did not accept, no window is opened for
+// HTTP_UPSTREAM_MIN_RETRY_INTERVAL. The interval doubles with every further failed window up to
+// HTTP_UPSTREAM_MAX_RETRY_INTERVAL. Otherwise a full buffer or a pending alarm would turn the radio on in every poll.
+//
+// The first window is opened right away, because samples can only be buffered once the time was synchronized.
+//
+// radioOn and radioOff use WiFi by default. Override them for other radios.
+
+/**
+ * @brief Creates a scheduler, which uploads through client and connects to WiFi only for flush windows.
+ *
+ * Flushes every 5 minutes or when a series buffer is 80% full by default.
+ *
+ * @param client registered client
+ * @param ssid
+ * @param pass
+ */
+HttpUpstreamScheduler::HttpUpstreamScheduler(HttpUpstreamClient &client, const char *ssid, const char *pass)
+{
+  _client = &client;
+  _ssid = ssid;
+  _pass = pass;
+  _seriesCount = 0;
+  _flushInterval = 300000;
+  _fillThreshold = 80;
+  _lastFlush = millis();
+  _retryInterval = 0;
+  _radioOnSince = 0;
+  _lastRadioOnTime = 0;
+  _totalRadioOnTime = 0;
+}
+
+/**
+ * @brief Adds a series buffer, which is uploaded in every flush window.
+ *
+ * @param buffer
+ * @return bool false = already HTTP_UPSTREAM_MAX_SERIES series added
+ */
+bool HttpUpstreamScheduler::addSeries(HttpUpstreamSeriesBuffer &buffer)
+{
+  if (_seriesCount >= HTTP_UPSTREAM_MAX_SERIES)
+  {
+    return false;
+  }
+  _series[_seriesCount++] = &buffer;
+  return true;
+}
+
+/**
+ * @brief Sets the time between flush windows.
+ *
+ * @param interval ms
+ */
+void HttpUpstreamScheduler::setFlushInterval(unsigned long interval)
+{
+  _flushInterval = interval;
+}
+
+/**
+ * @brief Sets how full a series buffer may get before it is flushed early.
+ *
+ * @param percent of the buffer capacity
+ */
+void HttpUpstreamScheduler::setFillThreshold(uint8_t percent)
+{
+  _fillThreshold = percent;
+}
+
+/**
+ * @brief Connects to WiFi.
+ *
+ * @return bool false = could not connect within HTTP_UPSTREAM_RADIO_TIMEOUT
+ */
+bool HttpUpstreamScheduler::radioOn()
+{
+  unsigned long start = millis();
+  WiFi.begin(_ssid, _pass);
+  while (WiFi.status() != WL_CONNECTED)
+  {
+    if (millis() - start > HTTP_UPSTREAM_RADIO_TIMEOUT)
+      return false;
+    delay(100);
+  }
+  return true;
+}
+
+/**
+ * @brief Disconnects from WiFi and turns the radio off.
+ */
+void HttpUpstreamScheduler::radioOff()
+{
+#if defined(ARDUINO_ARCH_ESP32)
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+#else
+  WiFi.end();
+#endif
+}
+
+/**
+ * @brief Turns the radio on, synchronizes the time and starts measuring the radio-on time.
+ *
+ * @return bool false = radio could not connect or the time was never synchronized; the radio is turned off again
+ */
+bool HttpUpstreamScheduler::beginWindow()
+{
+  _radioOnSince = millis();
+  if (!radioOn())
+  {
+    Serial.println("Could not connect for flush window.");
+    endWindow();
+    return false;
+  }
+  if (!_client->syncTime())
+  {
+    Serial.println("Could not synchronize time.");
+    endWindow();
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Turns the radio off and reports the radio-on time of the window.
+ */
+void HttpUpstreamScheduler::endWindow()
+{
+  radioOff();
+  _lastRadioOnTime = millis() - _radioOnSince;
+  _totalRadioOnTime += _lastRadioOnTime;
+  _lastFlush = millis();
+
+  Serial.print("Radio was on for ");
+  Serial.print(_lastRadioOnTime);
+  Serial.println(" ms.");
+}
+
+/**
+ * @brief Resets the retry interval after a successful window or increases it after a failed one.
+ *
+ * @param status 0 = window succeeded
+ */
+void HttpUpstreamScheduler::windowResult(int status)
+{
+  if (status == 0)
+    _retryInterval = 0;
+  else
+    _retryInterval = constrain(_retryInterval * 2, HTTP_UPSTREAM_MIN_RETRY_INTERVAL, HTTP_UPSTREAM_MAX_RETRY_INTERVAL);
+}
+
+/**
+ * @brief Whether the last window failed less than the retry interval ago.
+ */
+bool HttpUpstreamScheduler::isBackingOff()
+{
+  return _retryInterval > 0 && millis() - _lastFlush < _retryInterval;
+}
+
+/**
+ * @brief Uploads all series. The radio must be on.
+ *
+ * @return int 0 = ok, else status of the first failed HttpUpstreamClient::sendMeasurements
+ */
+int HttpUpstreamScheduler::sendSeries()
+{
+  int status = 0;
+  for (uint8_t i = 0; i < _seriesCount; i++)
+  {
+    if (_series[i]->size() == 0)
+      continue;
+    int seriesStatus = _client->sendMeasurements(*_series[i]);
+    if (!status)
+      status = seriesStatus;
+  }
+  return status;
+}
+
+/**
+ * @brief Buffers a measurement with the current time until the next flush window.
+ *
+ * Does not use the radio. Until the time was synchronized, samples are not buffered, because their time would be wrong;
+ * poll opens a window for synchronizing the time first.
+ *
+ * @param buffer
+ * @param value
+ * @return bool false = time was never synchronized, value is NaN or infinite, or buffer is too small for a single sample
+ */
+bool HttpUpstreamScheduler::bufferMeasurement(HttpUpstreamSeriesBuffer &buffer, float value)
+{
+  return _client->bufferMeasurement(buffer, value);
+}
+
+/**
+ * @brief Raises an alarm right away, see HttpUpstreamClient::raiseAlarm.
+ *
+ * Only turns the radio on, if the tenant has to be updated, see HttpUpstreamClient::alarmNeedsUpdate. Buffered measurements are sent in the same window.
+ * While backing off after a failed window, the radio is not turned on and the alarm state change is not sent.
+ *
+ * @param type
+ * @param text
+ * @param severity
+ * @return int 0 = ok, 5 = radio could not connect, time could not be synchronized or backing off, else see HttpUpstreamClient::raiseAlarm
+ */
+int HttpUpstreamScheduler::raiseAlarm(char *type, char *text, char *severity)
+{
+  if (!_client->alarmNeedsUpdate(type, severity))
+  {
+    return _client->raiseAlarm(type, text, severity);
+  }
+
+  if (isBackingOff())
+  {
+    return 5;
+  }
+  if (!beginWindow())
+  {
+    windowResult(5);
+    return 5;
+  }
+  int status = _client->raiseAlarm(type, text, severity);
+  int seriesStatus = sendSeries();
+  endWindow();
+  windowResult(status ? status : seriesStatus);
+  return status;
+}
+
+/**
+ * @brief Clears an alarm right away, see HttpUpstreamClient::clearAlarm.
+ *
+ * Only turns the radio on, if the alarm is active. Buffered measurements are sent in the same window.
+ * While backing off after a failed window, the radio is not turned on and the alarm stays active.
+ *
+ * @param type
+ * @return int 0 = ok, 5 = radio could not connect, time could not be synchronized or backing off, else see HttpUpstreamClient::clearAlarm
+ */
+int HttpUpstreamScheduler::clearAlarm(char *type)
+{
+  if (!_client->alarmSeverity(type))
+  {
+    return 0;
+  }
+
+  if (isBackingOff())
+  {
+    return 5;
+  }
+  if (!beginWindow())
+  {
+    windowResult(5);
+    return 5;
+  }
+  int status = _client->clearAlarm(type);
+  int seriesStatus = sendSeries();
+  endWindow();
+  windowResult(status ? status : seriesStatus);
+  return status;
+}
+
+/**
+ * @brief Flushes, if the time was never synchronized, the flush interval elapsed or a series buffer passed the fill threshold.
+ *
+ * Call this from loop. Does nothing while backing off after a failed window.
+ *
+ * @return int 0 = ok or nothing to do, else see flush
+ */
+int HttpUpstreamScheduler::poll()
+{
+  if (isBackingOff())
+  {
+    return 0;
+  }
+  bool due = !_client->isTimeSynced() || millis() - _lastFlush >= _flushInterval;
+  for (uint8_t i = 0; i < _seriesCount && !due; i++)
+  {
+    due = (unsigned long)_series[i]->bytesUsed() * 100 >= (unsigned long)_series[i]->capacity() * _fillThreshold;
+  }
+  return due ? flush() : 0;
+}
+
+/**
+ * @brief Turns the radio on, uploads all series and turns the radio off again.
+ *
+ * Does not turn the radio on, if nothing is buffered and the time is synchronized.
+ *
+ * @return int 0 = ok, 5 = radio could not connect or time could not be synchronized, else see HttpUpstreamClient::sendMeasurements
+ */
+int HttpUpstreamScheduler::flush()
+{
+  bool empty = true;
+  for (uint8_t i = 0; i < _seriesCount; i++)
+  {
+    empty = empty && _series[i]->size() == 0;
+  }
+  if (empty && _client->isTimeSynced())
+  {
+    _lastFlush = millis();
+    return 0;
+  }
+
+  if (!beginWindow())
+  {
+    windowResult(5);
+    return 5;
+  }
+  int status = sendSeries();
+  endWindow();
+  windowResult(status);
+  return status;
+}
+
+/**
+ * @brief Radio-on time of the last flush window in ms
+ */
+unsigned long HttpUpstreamScheduler::lastRadioOnTime()
+{
+  return _lastRadioOnTime;
+}
+
+/**
+ * @brief Radio-on time of all flush windows in ms
+ */
+unsigned long HttpUpstreamScheduler::totalRadioOnTime()
+{
+  return _totalRadioOnTime;
+}
@@ -0,0 +1,68 @@
+
+#ifndef HttpUpstreamScheduler_h
+#define HttpUpstreamScheduler_h
+
+#include "HttpUpstream.h"
+
+// Not overridable: it sets the size of HttpUpstreamScheduler, and the library is compiled without the defines of the sketch.
+#define HTTP_UPSTREAM_MAX_SERIES 4
+
+#ifndef HTTP_UPSTREAM_RADIO_TIMEOUT
+#define HTTP_UPSTREAM_RADIO_TIMEOUT 15000 // ms
+#endif
+
+#ifndef HTTP_UPSTREAM_MIN_RETRY_INTERVAL
+#define HTTP_UPSTREAM_MIN_RETRY_INTERVAL 30000 // ms
+#endif
+
+#ifndef HTTP_UPSTREAM_MAX_RETRY_INTERVAL
+#define HTTP_UPSTREAM_MAX_RETRY_INTERVAL 1800000 // ms
+#endif
+
+class HttpUpstreamScheduler
+{
+
+private:
+  HttpUpstreamClient *_client;
+  const char *_ssid;
+  const char *_pass;
+  HttpUpstreamSeriesBuffer *_series[HTTP_UPSTREAM_MAX_SERIES];
+  uint8_t _seriesCount;
+  unsigned long _flushInterval;
+  uint8_t _fillThreshold;
+  unsigned long _lastFlush;
+  unsigned long _retryInterval;
+  unsigned long _radioOnSince;
+  unsigned long _lastRadioOnTime;
+  unsigned long _totalRadioOnTime;
+
+  bool beginWindow();
+  void endWindow();
+  void windowResult(int status);
+  bool isBackingOff();
+  int sendSeries();
+
+protected:
+  virtual bool radioOn();
+  virtual void radioOff();
+
+public:
+  HttpUpstreamScheduler(HttpUpstreamClient &client, const char *ssid, const char *pass);
+  virtual ~HttpUpstreamScheduler() {}
+
+  bool addSeries(HttpUpstreamSeriesBuffer &buffer);
+  void setFlushInterval(unsigned long interval);
+  void setFillThreshold(uint8_t percent);
+
+  bool bufferMeasurement(HttpUpstreamSeriesBuffer &buffer, float value);
+  int raiseAlarm(char *type, char *text, char *severity);
+  int clearAlarm(char *type);
+
+  int poll();
+  int flush();
+
+  unsigned long lastRadioOnTime();
+  unsigned long totalRadioOnTime();
+};
+
+#endif
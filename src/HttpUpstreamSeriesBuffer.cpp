@@ -0,0 +1,370 @@
+#include "HttpUpstreamSeriesBuffer.h"
+
+// Implementation notes
+//
+// Samples of a single series are kept in a byte ring buffer, which is supplied by the caller.
+// Every sample is stored as the difference to the sample before it:
+// * timestamp: seconds since the previous sample, zigzag and varint encoded
+// * value: if a scale is given, the value is stored as a scaled integer, e.g. 23.45 with scale 100 as 2345,
+//   and its difference to the previous value is zigzag and varint encoded.
+//   Otherwise the bits of the float are XORed with the bits of the previous value and varint encoded.
+//   Similar floats share sign, exponent and upper mantissa, so the XOR has few significant bits.
+//
+// A slowly changing series usually needs 2-4 bytes per sample instead of ~200 bytes as formatted JSON.
+//
+// The oldest and newest sample are kept decoded. The oldest, because the sample it was encoded against is gone,
+// and the newest, because the next sample is encoded against it.
+// When the ring buffer is full, the oldest samples are dropped.
+//
+// Timestamp and value deltas of a sample are stored next to each other instead of in separate columns.
+// Both are variable length, so separate columns would need two ring buffers, which can run full independently,
+// and dropping, requeueing and reading a sample would have to keep two read positions in step.
+// The compression comes from the delta encoding, not from the layout, so a single ring is just as small.
+//
+// NaN and infinite values are rejected, because they cannot be sent as JSON numbers.
+
+static uint32_t zigzag(int32_t value)
+{
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static uint8_t writeVarint(uint8_t *buffer, uint32_t value)
+{
+  uint8_t length = 0;
+  while (value >= 0x80)
+  {
+    buffer[length++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  buffer[length++] = value;
+  return length;
+}
+
+/**
+ * @brief Creates a buffer for samples of a single series.
+ *
+ * @param storage memory for the encoded samples, e.g. a static array
+ * @param size size of storage in bytes
+ * @param type measurement type, e.g. c8y_TemperatureMeasurement
+ * @param fragment e.g. c8y_Steam
+ * @param series e.g. T
+ * @param unit e.g. C; NULL = no unit
+ * @param scale factor for storing values as integers, e.g. 100 for two decimals; 0 = store floats
+ */
+HttpUpstreamSeriesBuffer::HttpUpstreamSeriesBuffer(uint8_t *storage, uint16_t size, char *type, char *fragment, char *series, char *unit, float scale)
+{
+  _data = storage;
+  _capacity = size;
+  _scale = scale;
+  this->type = type;
+  this->fragment = fragment;
+  this->series = series;
+  this->unit = unit;
+  _dropped = 0;
+  clear();
+}
+
+/**
+ * @brief Removes all samples.
+ */
+void HttpUpstreamSeriesBuffer::clear()
+{
+  _head = 0;
+  _used = 0;
+  _count = 0;
+  _headTime = 0;
+  _headValue = 0;
+  _tailTime = 0;
+  _tailValue = 0;
+}
+
+uint32_t HttpUpstreamSeriesBuffer::encodeValue(float value)
+{
+  if (isScaled())
+  {
+    return (uint32_t)(int32_t)lround(value * _scale);
+  }
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+uint32_t HttpUpstreamSeriesBuffer::applyValueDelta(uint32_t value, uint32_t valueDelta)
+{
+  if (isScaled())
+  {
+    return (uint32_t)((int32_t)value + unzigzag(valueDelta));
+  }
+  return value ^ valueDelta;
+}
+
+/**
+ * @brief Decodes the record at offset.
+ *
+ * @return uint8_t length of the record in bytes
+ */
+uint8_t HttpUpstreamSeriesBuffer::readRecord(uint16_t offset, int32_t &timeDelta, uint32_t &valueDelta)
+{
+  uint8_t length = 0;
+  for (uint8_t field = 0; field < 2; field++)
+  {
+    uint32_t value = 0;
+    uint8_t shift = 0;
+    uint8_t b;
+    do
+    {
+      b = _data[(offset + length++) % _capacity];
+      value |= (uint32_t)(b & 0x7F) << shift;
+      shift += 7;
+    } while (b & 0x80);
+
+    if (field == 0)
+      timeDelta = unzigzag(value);
+    else
+      valueDelta = value;
+  }
+  return length;
+}
+
+void HttpUpstreamSeriesBuffer::dropOldest()
+{
+  int32_t timeDelta;
+  uint32_t valueDelta;
+  uint8_t length = readRecord(_head, timeDelta, valueDelta);
+  _head = (_head + length) % _capacity;
+  _used -= length;
+  _count--;
+  _dropped++;
+
+  if (_count > 0)
+  {
+    // The new oldest sample was encoded against the dropped one
+    readRecord(_head, timeDelta, valueDelta);
+    _headTime += timeDelta;
+    _headValue = applyValueDelta(_headValue, valueDelta);
+  }
+}
+
+/**
+ * @brief Appends a sample. Drops the oldest samples, if the buffer is full.
+ *
+ * @param time seconds since epoch
+ * @param value
+ * @return bool false = value is NaN or infinite, or the buffer is too small for a single sample
+ */
+bool HttpUpstreamSeriesBuffer::add(uint32_t time, float value)
+{
+  if (isnan(value) || isinf(value))
+  {
+    return false;
+  }
+  return append(time, encodeValue(value), true);
+}
+
+/**
+ * @brief Appends an encoded sample.
+ *
+ * @param time seconds since epoch
+ * @param encodedValue
+ * @param evict whether to drop the oldest samples to make room
+ * @return bool false = there is no room for the sample
+ */
+bool HttpUpstreamSeriesBuffer::append(uint32_t time, uint32_t encodedValue, bool evict)
+{
+  if (_count == 0)
+  {
+    _headTime = time;
+    _headValue = encodedValue;
+    _tailTime = time;
+    _tailValue = encodedValue;
+  }
+
+  uint8_t record[10];
+  uint8_t length = writeVarint(record, zigzag((int32_t)(time - _tailTime)));
+  if (isScaled())
+    length += writeVarint(record + length, zigzag((int32_t)(encodedValue - _tailValue)));
+  else
+    length += writeVarint(record + length, encodedValue ^ _tailValue);
+
+  if (length > _capacity || (!evict && _capacity - _used < length))
+  {
+    return false;
+  }
+  while (_capacity - _used < length)
+  {
+    dropOldest();
+    if (_count == 0)
+    {
+      // Everything was dropped, so the sample has to be encoded against itself
+      return append(time, encodedValue, evict);
+    }
+  }
+
+  for (uint8_t i = 0; i < length; i++)
+  {
+    _data[(_head + _used + i) % _capacity] = record[i];
+  }
+  _used += length;
+  _count++;
+  _tailTime = time;
+  _tailValue = encodedValue;
+  return true;
+}
+
+/**
+ * @brief Removes the oldest samples, e.g. after they were uploaded.
+ *
+ * Removed samples are not counted as dropped.
+ *
+ * @param count number of samples
+ */
+void HttpUpstreamSeriesBuffer::drop(uint16_t count)
+{
+  unsigned long dropped = _dropped;
+  while (count-- > 0 && _count > 0)
+  {
+    dropOldest();
+  }
+  _dropped = dropped;
+}
+
+/**
+ * @brief Moves the oldest samples behind the newest one, e.g. to retry them after a failed upload.
+ *
+ * Samples are never dropped to make room for moved samples. In the rare case that a moved sample needs more room
+ * than it had before and the buffer is full, it is dropped instead.
+ *
+ * @param count number of samples
+ */
+void HttpUpstreamSeriesBuffer::requeue(uint16_t count)
+{
+  while (count-- > 0 && _count > 0)
+  {
+    uint32_t time = _headTime;
+    uint32_t encodedValue = _headValue;
+    if (_count == 1)
+    {
+      return;
+    }
+    dropOldest();
+    if (append(time, encodedValue, false))
+    {
+      _dropped--;
+    }
+  }
+}
+
+/**
+ * @brief Starts reading samples from the oldest one.
+ *
+ * @param cursor
+ */
+void HttpUpstreamSeriesBuffer::begin(HttpUpstreamSeriesCursor &cursor)
+{
+  cursor.offset = _head;
+  cursor.index = 0;
+  cursor.time = _headTime;
+  cursor.value = _headValue;
+}
+
+/**
+ * @brief Reads the next sample.
+ *
+ * The cursor is invalid after samples were added or dropped.
+ *
+ * @param cursor
+ * @param time seconds since epoch
+ * @param value
+ * @return bool false = no more samples
+ */
+bool HttpUpstreamSeriesBuffer::next(HttpUpstreamSeriesCursor &cursor, uint32_t &time, float &value)
+{
+  if (cursor.index >= _count)
+  {
+    return false;
+  }
+
+  int32_t timeDelta;
+  uint32_t valueDelta;
+  uint8_t length = readRecord(cursor.offset, timeDelta, valueDelta);
+  if (cursor.index > 0)
+  {
+    cursor.time += timeDelta;
+    cursor.value = applyValueDelta(cursor.value, valueDelta);
+  }
+  cursor.offset = (cursor.offset + length) % _capacity;
+  cursor.index++;
+
+  time = cursor.time;
+  if (isScaled())
+  {
+    value = (int32_t)cursor.value / _scale;
+  }
+  else
+  {
+    memcpy(&value, &cursor.value, sizeof(value));
+  }
+  return true;
+}
+
+/**
+ * @brief Number of buffered samples
+ */
+uint16_t HttpUpstreamSeriesBuffer::size()
+{
+  return _count;
+}
+
+/**
+ * @brief Number of bytes used by the buffered samples
+ */
+uint16_t HttpUpstreamSeriesBuffer::bytesUsed()
+{
+  return _used;
+}
+
+/**
+ * @brief Size of the storage in bytes
+ */
+uint16_t HttpUpstreamSeriesBuffer::capacity()
+{
+  return _capacity;
+}
+
+/**
+ * @brief Number of samples dropped, because the buffer was full
+ */
+unsigned long HttpUpstreamSeriesBuffer::dropped()
+{
+  return _dropped;
+}
+
+/**
+ * @brief Whether values are stored as scaled integers instead of floats
+ */
+bool HttpUpstreamSeriesBuffer::isScaled()
+{
+  return _scale != 0;
+}
+
+/**
+ * @brief Number of decimals needed to print the values, e.g. 2 for scale 100
+ */
+uint8_t HttpUpstreamSeriesBuffer::decimals()
+{
+  if (!isScaled())
+  {
+    return HTTP_UPSTREAM_FLOAT_DECIMALS;
+  }
+  uint8_t decimals = 0;
+  for (float scale = 1; scale < _scale; scale *= 10)
+  {
+    decimals++;
+  }
+  return decimals;
+}
@@ -0,0 +1,67 @@
+
+#ifndef HttpUpstreamSeriesBuffer_h
+#define HttpUpstreamSeriesBuffer_h
+
+#include "Arduino.h"
+
+#ifndef HTTP_UPSTREAM_FLOAT_DECIMALS
+#define HTTP_UPSTREAM_FLOAT_DECIMALS 2
+#endif
+
+struct HttpUpstreamSeriesCursor
+{
+  uint16_t offset;
+  uint16_t index;
+  uint32_t time;
+  uint32_t value;
+};
+
+class HttpUpstreamSeriesBuffer
+{
+
+private:
+  uint8_t *_data;
+  uint16_t _capacity;
+  uint16_t _head;
+  uint16_t _used;
+  uint16_t _count;
+  unsigned long _dropped;
+  float _scale;
+
+  // Oldest and newest sample, decoded
+  uint32_t _headTime;
+  uint32_t _headValue;
+  uint32_t _tailTime;
+  uint32_t _tailValue;
+
+  uint32_t encodeValue(float value);
+  bool append(uint32_t time, uint32_t encodedValue, bool evict);
+  uint8_t readRecord(uint16_t offset, int32_t &timeDelta, uint32_t &valueDelta);
+  uint32_t applyValueDelta(uint32_t value, uint32_t valueDelta);
+  void dropOldest();
+
+public:
+  char *type;
+  char *fragment;
+  char *series;
+  char *unit;
+
+  HttpUpstreamSeriesBuffer(uint8_t *storage, uint16_t size, char *type, char *fragment, char *series, char *unit = NULL, float scale = 0);
+
+  bool add(uint32_t time, float value);
+  void drop(uint16_t count);
+  void requeue(uint16_t count);
+  void clear();
+
+  void begin(HttpUpstreamSeriesCursor &cursor);
+  bool next(HttpUpstreamSeriesCursor &cursor, uint32_t &time, float &value);
+
+  uint16_t size();
+  uint16_t bytesUsed();
+  uint16_t capacity();
+  unsigned long dropped();
+  bool isScaled();
+  uint8_t decimals();
+};
+
+#endif